@@ -0,0 +1,409 @@
+// Benchmark of all libalgo structures on seeded, reproducible workloads.
+//
+// Usage: benchmark [--min-scale E] [--max-scale E] [--seed S] [--json FILE]
+//                  [--only STRUCTURE]
+//
+// Every workload is run at scales 10^min-scale, ..., 10^max-scale (defaults 3 and 6,
+// up to 8), each (structure, scale) in a forked child process so the memory of one
+// doesn't count towards the next. Scales a structure can't fit in memory are skipped
+// (see kWorkloads), as are the scales above one whose child failed. For every
+// (structure, operation, scale) it reports:
+//   - throughput (operations per second of the whole run),
+//   - latency percentiles - up to kLatencySamples operations spread evenly over the
+//     run are timed one by one, the numbers include the cost of reading the clock;
+//     null for runs of a single call (a build, a whole batch of queries),
+//   - peak RSS of the child during the run (VmHWM, reset before every run on Linux;
+//     without /proc it's the peak of the child so far),
+//   - allocations per operation (calls to the global operator new).
+// Results go to stdout (or FILE) as JSON, a readable summary goes to stderr.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libalgo/interval_tree.hh"
+#include "libalgo/partitioned_suffix_tree.hh"
+#include "libalgo/set.hh"
+#include "libalgo/suffix_tree.hh"
+
+namespace {
+std::atomic<std::uint64_t> allocations(0);
+} // namespace
+
+// Counting replacements of the global allocation functions. GCC can't tell that
+// these are a matching pair and warns about free() of new-ed memory.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *result = std::malloc(size == 0 ? 1 : size))
+    return result;
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
+
+namespace {
+
+using steady = std::chrono::steady_clock;
+
+constexpr size_t kLatencySamples = 100000;
+// Query workloads are capped so the queries themselves don't dominate the memory
+constexpr size_t kMaxQueries = 1000000;
+
+// Results of the queries end up here so the compiler can't drop them
+volatile std::uint64_t sink = 0;
+
+struct result {
+  std::string structure, operation;
+  size_t scale, operations;
+  double seconds;
+  // Latency percentiles in nanoseconds, meaningless with fewer than 2 samples
+  size_t latency_samples;
+  double p50, p90, p99, p999, max;
+  double allocations_per_operation;
+  long peak_rss_kb;
+};
+
+void reset_peak_rss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs)
+    clear_refs << "5";
+}
+
+long peak_rss_kb() {
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);)
+    if (line.rfind("VmHWM:", 0) == 0)
+      return std::stol(line.substr(6));
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+class Runner {
+  std::vector<result> results;
+
+  // Calls op(i) for i in [0, calls), which together do `operations` operations
+  template <typename F>
+  void measure(const std::string &structure, const std::string &operation, size_t scale,
+               size_t operations, size_t calls, F op) {
+    result r{structure, operation, scale, operations, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    const size_t stride = std::max<size_t>(1, calls / kLatencySamples);
+    std::vector<double> latencies;
+    latencies.reserve(calls / stride + 1);
+    reset_peak_rss();
+    const std::uint64_t allocated = allocations.load();
+    const auto start = steady::now();
+    for (size_t i = 0; i < calls; i++)
+      if (i % stride == 0) {
+        const auto before = steady::now();
+        op(i);
+        latencies.push_back(
+            std::chrono::duration<double, std::nano>(steady::now() - before).count());
+      } else {
+        op(i);
+      }
+    r.seconds = std::chrono::duration<double>(steady::now() - start).count();
+    // The latency samples are reserved up front, so this counts only the operations
+    r.allocations_per_operation =
+        double(allocations.load() - allocated) / std::max<size_t>(1, operations);
+    r.peak_rss_kb = peak_rss_kb();
+    std::sort(latencies.begin(), latencies.end());
+    r.latency_samples = latencies.size();
+    auto percentile = [&latencies](double p) {
+      if (latencies.empty())
+        return 0.0;
+      return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))];
+    };
+    r.p50 = percentile(0.5);
+    r.p90 = percentile(0.9);
+    r.p99 = percentile(0.99);
+    r.p999 = percentile(0.999);
+    r.max = latencies.empty() ? 0 : latencies.back();
+    std::cerr << structure << " " << operation << " n=" << scale << ": "
+              << operations / std::max(r.seconds, 1e-9) << " ops/s, ";
+    if (r.latency_samples > 1)
+      std::cerr << "p50 " << r.p50 << " ns, p99 " << r.p99 << " ns, ";
+    std::cerr << "peak RSS " << r.peak_rss_kb << " kB, " << r.allocations_per_operation
+              << " allocations/op" << std::endl;
+    results.push_back(std::move(r));
+  }
+
+public:
+  // Runs op(i) for i in [0, operations) and records the measurements
+  template <typename F>
+  void run(const std::string &structure, const std::string &operation, size_t scale,
+           size_t operations, F op) {
+    measure(structure, operation, scale, operations, operations, op);
+  }
+
+  // Runs op() once, doing `operations` operations at once (e.g. a batch of queries).
+  // Throughput and allocations are per operation, latencies aren't reported.
+  template <typename F>
+  void run_batch(const std::string &structure, const std::string &operation,
+                 size_t scale, size_t operations, F op) {
+    measure(structure, operation, scale, operations, 1, [&op](size_t) { op(); });
+  }
+
+  // Results travel from the child processes as text, one per line
+  void serialize(std::ostream &out) const {
+    out.precision(17);
+    for (const result &r : results)
+      out << r.structure << " " << r.operation << " " << r.scale << " " << r.operations
+          << " " << r.seconds << " " << r.latency_samples << " " << r.p50 << " "
+          << r.p90 << " " << r.p99 << " " << r.p999 << " " << r.max << " "
+          << r.allocations_per_operation << " " << r.peak_rss_kb << "\n";
+  }
+
+  void deserialize(std::istream &in) {
+    for (result r; in >> r.structure >> r.operation >> r.scale >> r.operations >>
+                   r.seconds >> r.latency_samples >> r.p50 >> r.p90 >> r.p99 >>
+                   r.p999 >> r.max >> r.allocations_per_operation >> r.peak_rss_kb;)
+      results.push_back(r);
+  }
+
+  void write_json(std::ostream &out, std::uint64_t seed) const {
+    out << "{\n  \"seed\": " << seed << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+      const result &r = results[i];
+      out << (i ? "," : "") << "\n    {\"structure\": \"" << r.structure
+          << "\", \"operation\": \"" << r.operation << "\", \"scale\": " << r.scale
+          << ", \"operations\": " << r.operations << ", \"seconds\": " << r.seconds
+          << ", \"throughput_per_second\": "
+          << r.operations / std::max(r.seconds, 1e-9) << ", \"latency_ns\": ";
+      if (r.latency_samples > 1)
+        out << "{\"p50\": " << r.p50 << ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99
+            << ", \"p999\": " << r.p999 << ", \"max\": " << r.max << "}";
+      else
+        out << "null";
+      out << ", \"peak_rss_kb\": " << r.peak_rss_kb
+          << ", \"allocations_per_operation\": " << r.allocations_per_operation
+          << "}";
+    }
+    out << "\n  ]\n}\n";
+  }
+};
+
+void interval_tree(Runner &runner, size_t n, std::uint64_t seed) {
+  const int64_t range = int64_t(1) << 40;
+  std::mt19937_64 rng(seed);
+  auto interval = [&rng, range] {
+    int64_t b = rng() % range, e = rng() % range;
+    return std::make_pair(std::min(b, e), std::max(b, e) + 1);
+  };
+  libalgo::IntervalTree<int64_t, int64_t> tree(0, range);
+  runner.run("IntervalTree", "add", n, n, [&](size_t) {
+    auto [b, e] = interval();
+    tree.add(int64_t(rng() % 1000) - 500, b, e);
+  });
+  runner.run("IntervalTree", "query", n, n, [&](size_t) {
+    auto [b, e] = interval();
+    sink = sink + tree.query(b, e);
+  });
+}
+
+void splay_set(Runner &runner, size_t n, std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  const int64_t range = 4 * int64_t(n);
+  libalgo::SplaySet<int64_t> set;
+  runner.run("SplaySet", "insert", n, n,
+             [&](size_t) { set.insert(int64_t(rng() % range)); });
+  size_t found = 0;
+  runner.run("SplaySet", "find", n, n,
+             [&](size_t) { found += set.find(int64_t(rng() % range)); });
+  // Skewed lookups - the splay tree keeps the hot keys close to the root
+  runner.run("SplaySet", "find_hot", n, n,
+             [&](size_t) { found += set.find(int64_t(rng() % 64)); });
+  runner.run("SplaySet", "shift", n, n,
+             [&](size_t) { set.shift(int64_t(rng() % range), 1); });
+  runner.run("SplaySet", "erase", n, n,
+             [&](size_t) { set.erase(int64_t(rng() % range)); });
+  sink = sink + found;
+}
+
+void suffix_tree(Runner &runner, size_t n, std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::string text(n, 'a');
+  for (auto &c : text)
+    c = char('a' + rng() % 4);
+  std::vector<std::string> queries(std::min(n, kMaxQueries));
+  for (auto &query : queries) {
+    // Half of the queries occur in the text
+    const size_t length = std::min<size_t>(16, n);
+    if (rng() % 2) {
+      query = text.substr(rng() % (n - length + 1), length);
+    } else {
+      query.resize(length);
+      for (auto &c : query)
+        c = char('a' + rng() % 4);
+    }
+  }
+
+  std::optional<libalgo::SuffixTree<std::string>> tree;
+  runner.run("SuffixTree", "build", n, 1, [&](size_t) { tree.emplace(text); });
+  size_t found = 0;
+  runner.run("SuffixTree", "find", n, queries.size(),
+             [&](size_t i) { found += tree->find(queries[i]); });
+  runner.run_batch("SuffixTree", "find_batch", n, queries.size(), [&] {
+    for (char x : tree->find_batch(queries))
+      found += x;
+  });
+  std::string other(n, 'a');
+  for (auto &c : other)
+    c = char('a' + rng() % 4);
+  runner.run("SuffixTree", "longest_common_substring", n, 1,
+             [&](size_t) { found += tree->longest_common_substring(other).length; });
+  tree.reset();
+
+  std::optional<libalgo::PartitionedSuffixTree<std::string>> partitioned;
+  runner.run("PartitionedSuffixTree", "build", n, 1,
+             [&](size_t) { partitioned.emplace(text); });
+  runner.run("PartitionedSuffixTree", "count", n, queries.size(),
+             [&](size_t i) { found += partitioned->count(queries[i]); });
+  sink = sink + found;
+}
+
+struct workload {
+  const char *structure;
+  // The largest scale whose data fits in memory - roughly 4.5 kB per interval of
+  // the IntervalTree (a node per level of the 2^40 range), 100 bytes per element of
+  // the SplaySet and 400 bytes per symbol of the SuffixTree, all on a few GB
+  size_t max_scale;
+  void (*run)(Runner &, size_t, std::uint64_t);
+};
+
+const workload kWorkloads[] = {
+    {"IntervalTree", 6, interval_tree},
+    {"SplaySet", 8, splay_set},
+    {"SuffixTree", 7, suffix_tree},
+};
+
+// Runs the workload in a child process and collects its results. False if the child
+// didn't finish (e.g. was killed for running out of memory).
+bool run_isolated(Runner &runner, const workload &w, size_t n, std::uint64_t seed) {
+  int channel[2];
+  if (pipe(channel) != 0)
+    return false;
+  std::cerr.flush();
+  std::cout.flush();
+  const pid_t child = fork();
+  if (child < 0) {
+    close(channel[0]);
+    close(channel[1]);
+    return false;
+  }
+  if (child == 0) {
+    close(channel[0]);
+    Runner own;
+    w.run(own, n, seed);
+    std::ostringstream out;
+    own.serialize(out);
+    const std::string data = out.str();
+    for (size_t written = 0; written < data.size();) {
+      const ssize_t chunk =
+          write(channel[1], data.data() + written, data.size() - written);
+      if (chunk <= 0)
+        _exit(1);
+      written += chunk;
+    }
+    _exit(0);
+  }
+
+  close(channel[1]);
+  std::string data;
+  char buffer[4096];
+  for (ssize_t chunk; (chunk = read(channel[0], buffer, sizeof(buffer))) > 0;)
+    data.append(buffer, chunk);
+  close(channel[0]);
+  int status = 0;
+  waitpid(child, &status, 0);
+  if (!WIFEXITED(status) or WEXITSTATUS(status) != 0) {
+    std::cerr << w.structure << " n=" << n << ": child process failed";
+    if (WIFSIGNALED(status))
+      std::cerr << " (signal " << WTERMSIG(status) << ")";
+    std::cerr << ", skipping larger scales" << std::endl;
+    return false;
+  }
+  std::istringstream in(data);
+  runner.deserialize(in);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t min_scale = 3, max_scale = 6;
+  std::uint64_t seed = 42;
+  std::string json, only;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i], value = argv[i + 1];
+    if (flag == "--min-scale")
+      min_scale = std::stoul(value);
+    else if (flag == "--max-scale")
+      max_scale = std::stoul(value);
+    else if (flag == "--seed")
+      seed = std::stoull(value);
+    else if (flag == "--json")
+      json = value;
+    else if (flag == "--only")
+      only = value;
+    else {
+      std::cerr << "unknown option " << flag << std::endl;
+      return 2;
+    }
+  }
+  if (argc % 2 == 0 or min_scale < 1 or max_scale > 8 or min_scale > max_scale) {
+    std::cerr << "usage: " << argv[0]
+              << " [--min-scale E] [--max-scale E] [--seed S] [--json FILE]"
+                 " [--only IntervalTree|SplaySet|SuffixTree]  (1 <= E <= 8)"
+              << std::endl;
+    return 2;
+  }
+
+  Runner runner;
+  std::vector<bool> failed(std::size(kWorkloads));
+  for (size_t scale = min_scale; scale <= max_scale; scale++) {
+    size_t n = 1;
+    for (size_t i = 0; i < scale; i++)
+      n *= 10;
+    for (size_t w = 0; w < std::size(kWorkloads); w++) {
+      if ((!only.empty() and only != kWorkloads[w].structure) or failed[w])
+        continue;
+      if (scale > kWorkloads[w].max_scale) {
+        std::cerr << kWorkloads[w].structure << " n=" << n
+                  << ": skipped, the largest scale it fits in memory is 10^"
+                  << kWorkloads[w].max_scale << std::endl;
+        continue;
+      }
+      failed[w] = !run_isolated(runner, kWorkloads[w], n, seed);
+    }
+  }
+
+  if (json.empty()) {
+    runner.write_json(std::cout, seed);
+  } else {
+    std::ofstream out(json);
+    runner.write_json(out, seed);
+  }
+  return 0;
+}
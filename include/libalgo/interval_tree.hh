@@ -127,6 +127,37 @@ public:
 
   IntervalTree(IND_T size) : IntervalTree({}, size, nullptr){};
 
+  // The tree owns its nodes - it can be moved but not copied. A moved-from tree is
+  // empty again.
+  IntervalTree(const IntervalTree &) = delete;
+  IntervalTree &operator=(const IntervalTree &) = delete;
+  IntervalTree(IntervalTree &&other) noexcept
+      : begin(other.begin), end(other.end), ls(nullptr), rs(nullptr),
+        parent(nullptr) {
+    *this = std::move(other);
+  }
+  IntervalTree &operator=(IntervalTree &&other) noexcept {
+    if (this != &other) {
+      delete ls;
+      delete rs;
+      value = std::exchange(other.value, {});
+      max_subtree_value = std::exchange(other.max_subtree_value, {});
+      begin = other.begin;
+      end = other.end;
+      ls = std::exchange(other.ls, nullptr);
+      rs = std::exchange(other.rs, nullptr);
+      parent = std::exchange(other.parent, nullptr);
+      // The children point back at their parent
+      if (ls != nullptr)
+        ls->parent = rs->parent = this;
+    }
+    return *this;
+  }
+  ~IntervalTree() {
+    delete ls;
+    delete rs;
+  }
+
   void add(VAL_T val, IND_T begin_add, IND_T end_add) {
     assert(parent == nullptr);
 
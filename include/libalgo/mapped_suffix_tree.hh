@@ -0,0 +1,213 @@
+// Stanislaw Morawski
+//
+// Read-only view of a SuffixTree saved with `SuffixTree::save`.
+//
+// The file is `mmap`ed and queried in place, so opening even a huge index costs a
+// couple of system calls - pages are loaded lazily by the kernel as queries touch
+// them and are shared between all processes serving the same file.
+//
+// Opening checks the header (magic, byte order, format version, symbol size and file
+// size) and throws std::runtime_error if anything is off. It does not read the nodes
+// - that would defeat the purpose. `validate()` walks the whole file and checks that
+// every index points where it should, use it when the file comes from an untrusted
+// source.
+//
+// Interface:
+// MappedSuffixTree<T>(path) - maps the tree saved from a SuffixTree over symbols T
+// find(query) - true if query is a substring of the indexed text, O(|query| log(sigma))
+// size() - length of the indexed text, text() - pointer to the mapped text
+// node_count() - number of nodes in the tree
+// validate() - full structural check of the file, O(size of the file)
+
+#ifndef LIBALGO_MAPPED_SUFFIX_TREE
+#define LIBALGO_MAPPED_SUFFIX_TREE
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libalgo/suffix_tree_format.hh"
+
+namespace libalgo {
+
+template <typename T> class MappedSuffixTree {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Only trees over trivially copyable symbols can be mapped");
+
+  using record = suffix_tree_format::node_record;
+
+  const void *data = nullptr;
+  size_t length = 0;
+  const suffix_tree_format::header *head = nullptr;
+  const T *the_string = nullptr;
+  const record *nodes = nullptr;
+
+  [[noreturn]] static void fail(const std::string &path, const std::string &what) {
+    throw std::runtime_error("MappedSuffixTree: " + path + ": " + what);
+  }
+
+  void check_header(const std::string &path) const {
+    namespace fmt = suffix_tree_format;
+    if (length < sizeof(fmt::header))
+      fail(path, "file too small");
+    if (head->magic != fmt::kMagic)
+      fail(path, "not a suffix tree file");
+    if (head->byte_order != fmt::kByteOrderMark)
+      fail(path, "saved with a different byte order");
+    if (head->version != fmt::kVersion)
+      fail(path, "unsupported format version " + std::to_string(head->version));
+    if (head->symbol_size != sizeof(T))
+      fail(path, "symbol size mismatch");
+    if (head->node_size != sizeof(record))
+      fail(path, "node record size mismatch");
+    // Bound the counts before multiplying them so a corrupted header can't overflow
+    if (head->text_length > length / sizeof(T) or
+        head->node_count > length / sizeof(record) or head->node_count == 0)
+      fail(path, "corrupted header");
+    if (head->file_size != length or
+        fmt::file_size(head->text_length, sizeof(T), head->node_count) != length)
+      fail(path, "truncated or corrupted file");
+  }
+
+  const record *child(const record &x, const T &symbol) const {
+    // Children are sorted by the first symbol of their edge
+    using suffix_tree_format::symbol_less;
+    size_t lo = x.first_child, hi = x.first_child + x.child_count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (symbol_less(the_string[nodes[mid].left], symbol))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo == x.first_child + x.child_count or !(the_string[nodes[lo].left] == symbol))
+      return nullptr;
+    return nodes + lo;
+  }
+
+  void unmap() {
+    if (data != nullptr)
+      munmap(const_cast<void *>(data), length);
+    data = nullptr;
+  }
+
+public:
+  explicit MappedSuffixTree(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      fail(path, "cannot open");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      fail(path, "cannot stat");
+    }
+    length = st.st_size;
+    if (length == 0) {
+      close(fd);
+      fail(path, "file too small");
+    }
+    void *mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+      fail(path, "mmap failed");
+    data = mapped;
+
+    auto bytes = static_cast<const char *>(data);
+    head = reinterpret_cast<const suffix_tree_format::header *>(bytes);
+    try {
+      check_header(path);
+    } catch (...) {
+      unmap();
+      throw;
+    }
+    the_string = reinterpret_cast<const T *>(bytes + suffix_tree_format::text_offset());
+    nodes = reinterpret_cast<const record *>(
+        bytes + suffix_tree_format::nodes_offset(head->text_length, sizeof(T)));
+  }
+
+  MappedSuffixTree(const MappedSuffixTree &) = delete;
+  MappedSuffixTree &operator=(const MappedSuffixTree &) = delete;
+  MappedSuffixTree(MappedSuffixTree &&other) noexcept { *this = std::move(other); }
+  MappedSuffixTree &operator=(MappedSuffixTree &&other) noexcept {
+    if (this != &other) {
+      unmap();
+      data = std::exchange(other.data, nullptr);
+      length = std::exchange(other.length, 0);
+      head = std::exchange(other.head, nullptr);
+      the_string = std::exchange(other.the_string, nullptr);
+      nodes = std::exchange(other.nodes, nullptr);
+    }
+    return *this;
+  }
+  ~MappedSuffixTree() { unmap(); }
+
+  // A moved-from tree maps nothing and behaves as if it had no nodes at all
+  size_t size() const { return head != nullptr ? head->text_length : 0; }
+  const T *text() const { return the_string; }
+  size_t node_count() const { return head != nullptr ? head->node_count : 0; }
+
+  template <typename C2> bool find(const C2 &query) const {
+    if (nodes == nullptr)
+      return false;
+    const record *active = nodes;
+    size_t tree_ptr = active->right;
+    for (auto it = std::begin(query); it != std::end(query); it++, tree_ptr++) {
+      if (tree_ptr == active->right) {
+        active = child(*active, *it);
+        if (active == nullptr)
+          return false;
+        tree_ptr = active->left;
+      }
+      if (!(the_string[tree_ptr] == *it))
+        return false;
+    }
+    return true;
+  }
+
+  bool validate() const {
+    namespace fmt = suffix_tree_format;
+    if (head == nullptr)
+      return false;
+    const size_t n = head->text_length, count = head->node_count;
+    auto valid_link = [count](std::uint64_t x) { return x == fmt::kNoNode or x < count; };
+    // BFS numbering - the children (and empty leaves) of consecutive nodes take up
+    // consecutive ranges starting right after the root. So every node but the root
+    // has exactly one parent, and the parent has a smaller index - it's a tree.
+    size_t next = 1;
+    for (size_t i = 0; i < count; i++) {
+      const record &x = nodes[i];
+      if (x.first_child != next or x.first_child <= i or x.child_count > count or
+          x.first_child > count - x.child_count)
+        return false;
+      next += x.child_count + (x.empty_leaf != fmt::kNoNode);
+      if (i != 0 and (x.left > x.right or x.right > n))
+        return false;
+      if (!valid_link(x.fail) or !valid_link(x.empty_leaf))
+        return false;
+      if (x.empty_leaf != fmt::kNoNode and
+          x.empty_leaf != x.first_child + x.child_count)
+        return false;
+      for (size_t c = x.first_child; c < x.first_child + x.child_count; c++) {
+        if (nodes[c].left >= nodes[c].right or nodes[c].right > n)
+          return false;
+        if (c > x.first_child and !fmt::symbol_less(the_string[nodes[c - 1].left],
+                                                    the_string[nodes[c].left]))
+          return false;
+      }
+    }
+    return next == count;
+  }
+};
+
+} // namespace libalgo
+
+#endif // LIBALGO_MAPPED_SUFFIX_TREE
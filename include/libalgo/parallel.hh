@@ -0,0 +1,68 @@
+// Stanislaw Morawski
+//
+// Minimal helpers for running independent tasks on all cores.
+//
+// for_each_chunk(n, chunk, threads, f) splits [0, n) into chunks of `chunk` items and
+// calls f(begin, end) for each of them. Chunks are handed out dynamically from a
+// shared counter - a thread that finishes early simply grabs the next chunk - so
+// uneven tasks still keep all threads busy without any per-thread queues.
+// `threads == 0` means one thread per core. The calling thread takes part in the work
+// and the function returns once all chunks are done. If `f` throws, the remaining
+// chunks are skipped and the first exception is rethrown in the caller.
+
+#ifndef LIBALGO_PARALLEL
+#define LIBALGO_PARALLEL
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace libalgo {
+namespace parallel {
+
+inline size_t default_threads() {
+  return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+template <typename F>
+void for_each_chunk(size_t n, size_t chunk, size_t threads, F f) {
+  if (n == 0)
+    return;
+  chunk = std::max<size_t>(1, chunk);
+  const size_t chunks = (n + chunk - 1) / chunk;
+  threads = std::min(threads == 0 ? default_threads() : threads, chunks);
+
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&] {
+    for (size_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < chunks;) {
+      try {
+        f(c * chunk, std::min(n, (c + 1) * chunk));
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+          error = std::current_exception();
+        next.store(chunks, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < threads; i++)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &t : pool)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace parallel
+} // namespace libalgo
+
+#endif // LIBALGO_PARALLEL
@@ -0,0 +1,686 @@
+// Stanislaw Morawski
+//
+// Suffix tree built in parallel, partition by partition, for texts too big for
+// SuffixTree's sequential construction.
+//
+// Suffixes are partitioned by their leading symbols. Every prefix of up to
+// `code_length` symbols is packed into one 64 bit number (a digit per symbol, 0 past
+// the end of the text), so prefixes compare and hash as integers. That's
+// floor(log_(sigma + 1) 2^64) symbols - 7 for arbitrary bytes, 9 for printable text.
+// Prefixes shared by more suffixes than fit the memory budget of a single worker are
+// extended by another symbol until every partition fits or the prefix can't get any
+// longer. The counting is a parallel histogram over the text, one pass per prefix
+// length.
+//
+// Construction then goes through the partitions on all threads, phase by phase:
+//   1. one parallel pass over the text puts every suffix into its partition's slice
+//      of the suffix array,
+//   2. every partition sorts its slice in place by prefix doubling (Manber-Myers /
+//      Larsson-Sadakane): suffixes sorted by their first h symbols are sorted by the
+//      first 2h by comparing the ranks of the suffixes h further, so one comparison
+//      is O(1) however long the common prefixes are,
+//   3. the longest common prefixes of neighbouring suffixes come from Kasai's
+//      algorithm, run on a chunk of the text per thread,
+//   4. partitions still too big for a worker (their suffixes share more than
+//      code_length symbols) are split by the LCPs: the nodes of their trie with more
+//      than a worker's share of suffixes below go to the shared top, the smaller
+//      subtrees hanging from them are grouped into partitions that fit,
+//   5. every partition counts the nodes of its compacted trie, gets its own range
+//      of the node array and builds its trie there from its slice and the LCPs, with
+//      no locking - only hanging the finished subtrees into the top is sequential,
+//      one write per subtree.
+//
+// Because of the lexicographic order the leaves of the result read left to right
+// form the suffix array of the text, so every node only keeps the range of the
+// suffix array below it and occurrence queries are a slice of that array.
+//
+// Memory: the suffix array (which is a part of the result), the ranks and the LCPs
+// are shared, 3 words per symbol. A partition works on at most `memory_budget` bytes
+// of them and of the nodes it builds (kBytesPerSuffix per suffix of the partition).
+// Splitting an oversized partition (step 4) takes a stack of up to one entry per its
+// suffix - only very repetitive texts have those partitions at all.
+//
+// There are no suffix links in this tree - use SuffixTree when matching statistics
+// are needed.
+//
+// Interface:
+// PartitionedSuffixTree(text, threads = 0, memory_budget = kDefaultMemoryBudget)
+//   builds the tree using `threads` threads (0 = one per core)
+// find(query) - true if query is a substring of the text (the empty query always is)
+// count(query) - number of occurrences of the query in the text, the empty query
+//   occurs at every position 0, ..., |text| - 1
+// occurrences(query) - starting positions of all occurrences of the query, in
+//   lexicographic order of the suffixes starting there
+// partition_count() - number of partitions whose tries the workers built
+//
+// Complexity (n - length of the text, K - code_length, p - threads):
+// Planning and distributing the suffixes take O(n K / p). Sorting takes
+// O(log(n) n log(n) / p) in the worst case - every round of doubling sorts the
+// suffixes which still aren't told apart, with O(1) comparisons - and a round or two
+// on typical texts. LCPs take O(n) per thread, splitting oversized partitions O(their
+// size) each, the tries O(n / p).
+// find() and count() take O(|query| log(sigma)), occurrences() additionally
+// O(number of occurrences).
+
+#ifndef LIBALGO_PARTITIONED_SUFFIX_TREE
+#define LIBALGO_PARTITIONED_SUFFIX_TREE
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "libalgo/parallel.hh"
+#include "libalgo/type_check.hh"
+
+namespace libalgo {
+
+template <typename C> class PartitionedSuffixTree {
+
+public:
+  using T = _type_check::inner_type_t<C>;
+  using T_vec = std::vector<T>;
+
+  static constexpr size_t kDefaultMemoryBudget = size_t(256) << 20;
+
+private:
+  struct node {
+    // The label of the node is text[suffixes[lo], suffixes[lo] + depth) and
+    // suffixes[lo, hi) are all suffixes starting with it
+    size_t depth, lo, hi;
+    // Sorted by symbol
+    std::vector<std::pair<T, size_t>> children;
+
+    node(size_t depth, size_t lo, size_t hi = 0) : depth(depth), lo(lo), hi(hi){};
+  };
+
+public:
+  // What a partition works with per suffix: its slices of the suffix array, the
+  // ranks and the sorting keys, and at most two nodes with one child each
+  static constexpr size_t kBytesPerSuffix =
+      3 * sizeof(std::uint64_t) + 2 * (sizeof(node) + sizeof(std::pair<T, size_t>));
+
+private:
+  // Placeholder for a partition's subtree in the shared top until it's built
+  static constexpr size_t kPending = std::numeric_limits<size_t>::max();
+
+  struct partition {
+    // The prefix, `length` symbols packed into `code`. A `whole` prefix ends with the
+    // text - the partition is just that suffix, the longer ones starting with the
+    // same symbols belong to other partitions. Partitions split off an oversized one
+    // have no prefix of their own.
+    size_t length;
+    std::uint64_t code;
+    bool whole;
+    size_t count;
+    // Too big for a worker even with the longest prefix, split by the LCPs later
+    bool oversized = false;
+    // Slice of the suffix array. The subtrees of the partition are children
+    // slot, ..., slot + slots - 1 of node `attach` of the shared top.
+    size_t offset = 0, attach = 0, slot = 0, slots = 1;
+    // The subtrees, once built
+    std::vector<std::pair<T, size_t>> roots;
+  };
+
+  // Shared top of an oversized partition with node indices local to it
+  struct split_top {
+    std::vector<node> nodes;
+    std::vector<partition> parts;
+    size_t root = 0;
+  };
+
+  T_vec the_string;
+  std::vector<size_t> suffixes;
+  std::vector<node> nodes;
+  size_t partitions = 0;
+
+  size_t workers;
+  // Prefix codes: symbol alphabet[d - 1] is digit d, 0 is past the end of the text
+  T_vec alphabet;
+  std::uint64_t base = 1;
+  size_t code_length = 0;
+
+  std::uint64_t digit(size_t i) const {
+    if (i >= the_string.size())
+      return 0;
+    return std::lower_bound(alphabet.begin(), alphabet.end(), the_string[i]) -
+           alphabet.begin() + 1;
+  }
+
+  std::uint64_t power(size_t exponent) const {
+    std::uint64_t result = 1;
+    while (exponent--)
+      result *= base;
+    return result;
+  }
+
+  // Calls f(i, code of the k symbols starting at i) for i in [begin, end), right to
+  // left, rolling the code instead of recomputing it
+  template <typename F>
+  void for_each_code(size_t begin, size_t end, size_t k, F f) const {
+    if (begin >= end)
+      return;
+    const std::uint64_t first = power(k - 1);
+    std::uint64_t code = 0;
+    for (size_t j = 0; j < k; j++)
+      code = code * base + digit(end - 1 + j);
+    for (size_t i = end; i-- > begin;) {
+      if (i != end - 1)
+        code = digit(i) * first + code / base;
+      f(i, code);
+    }
+  }
+
+  // The text split into a chunk per `parts` of the threads
+  size_t text_chunk(size_t parts = 1) const {
+    return std::max<size_t>(1, (the_string.size() + workers * parts - 1) /
+                                   (workers * parts));
+  }
+
+  void init_codes() {
+    const size_t chunk = text_chunk();
+    std::vector<std::set<T>> seen((the_string.size() + chunk - 1) / chunk);
+    parallel::for_each_chunk(the_string.size(), chunk, workers,
+                             [&](size_t begin, size_t end) {
+                               auto &symbols = seen[begin / chunk];
+                               for (size_t i = begin; i < end; i++)
+                                 symbols.insert(the_string[i]);
+                             });
+    std::set<T> all;
+    for (const auto &symbols : seen)
+      all.insert(symbols.begin(), symbols.end());
+    alphabet.assign(all.begin(), all.end());
+    base = alphabet.size() + 1;
+    // The longest prefix whose codes fit in 64 bits
+    for (std::uint64_t all_codes = base;; all_codes *= base) {
+      code_length++;
+      if (all_codes > std::numeric_limits<std::uint64_t>::max() / base)
+        break;
+    }
+  }
+
+  // Partitions in lexicographic order of their prefixes
+  std::vector<partition> plan(size_t max_suffixes) const {
+    const size_t n = the_string.size(), chunk = text_chunk(4);
+    std::vector<partition> done;
+    // Codes of the prefixes of length k - 1 that have to be extended. The empty
+    // prefix has code 0.
+    std::unordered_set<std::uint64_t> oversized = {0};
+    for (size_t k = 1; !oversized.empty(); k++) {
+      using histogram_t = std::unordered_map<std::uint64_t, size_t>;
+      std::vector<histogram_t> histograms((n + chunk - 1) / chunk);
+      parallel::for_each_chunk(n, chunk, workers, [&](size_t begin, size_t end) {
+        auto &histogram = histograms[begin / chunk];
+        for_each_code(begin, end, k, [&](size_t, std::uint64_t code) {
+          if (oversized.count(code / base))
+            histogram[code]++;
+        });
+      });
+      std::map<std::uint64_t, size_t> counts;
+      for (const auto &histogram : histograms)
+        for (const auto &x : histogram)
+          counts[x.first] += x.second;
+
+      oversized.clear();
+      for (const auto &x : counts) {
+        const bool whole = x.first % base == 0;
+        if (whole or x.second <= max_suffixes) {
+          done.push_back(partition{k, x.first, whole, x.second});
+        } else if (k < code_length) {
+          oversized.insert(x.first);
+        } else {
+          done.push_back(partition{k, x.first, false, x.second});
+          done.back().oversized = true;
+        }
+      }
+    }
+
+    // Padded with zeros to the same length the codes compare as the prefixes
+    std::sort(done.begin(), done.end(), [this](const partition &a, const partition &b) {
+      return a.code * power(code_length - a.length) <
+             b.code * power(code_length - b.length);
+    });
+    for (size_t i = 1; i < done.size(); i++)
+      done[i].offset = done[i - 1].offset + done[i - 1].count;
+    return done;
+  }
+
+  // Puts every suffix into the slice of its partition; codes[i] gets the code of the
+  // first code_length symbols of suffix i
+  void distribute(const std::vector<partition> &parts,
+                  std::vector<std::uint64_t> &codes) {
+    const size_t n = the_string.size(), chunk = text_chunk();
+    const size_t chunks = (n + chunk - 1) / chunk;
+    std::vector<std::uint64_t> starts;
+    for (const auto &p : parts)
+      starts.push_back(p.code * power(code_length - p.length));
+    auto partition_of = [&starts](std::uint64_t code) {
+      return std::upper_bound(starts.begin(), starts.end(), code) - starts.begin() - 1;
+    };
+
+    // Where every chunk writes into every partition
+    std::vector<std::vector<size_t>> cursors(chunks, std::vector<size_t>(parts.size()));
+    parallel::for_each_chunk(n, chunk, workers, [&](size_t begin, size_t end) {
+      auto &counts = cursors[begin / chunk];
+      for_each_code(begin, end, code_length,
+                    [&](size_t, std::uint64_t code) { counts[partition_of(code)]++; });
+    });
+    for (size_t p = 0; p < parts.size(); p++)
+      for (size_t c = 0, offset = parts[p].offset; c < chunks; c++)
+        offset += std::exchange(cursors[c][p], offset);
+
+    parallel::for_each_chunk(n, chunk, workers, [&](size_t begin, size_t end) {
+      auto &cursor = cursors[begin / chunk];
+      for_each_code(begin, end, code_length, [&](size_t i, std::uint64_t code) {
+        suffixes[cursor[partition_of(code)]++] = i;
+        codes[i] = code;
+      });
+    });
+  }
+
+  // Sorts every slice of the suffix array. `rank` comes with the codes of the
+  // suffixes, on return rank[i] is the position of suffix i in the suffix array.
+  void sort_suffixes(const std::vector<partition> &parts,
+                     std::vector<std::uint64_t> &keys,
+                     std::vector<std::uint64_t> &rank) {
+    const size_t n = the_string.size();
+    // Ranges of the suffix array not sorted yet, per partition
+    using ranges_t = std::vector<std::pair<size_t, size_t>>;
+    std::vector<ranges_t> unsorted(parts.size());
+    for (size_t p = 0; p < parts.size(); p++)
+      unsorted[p].emplace_back(parts[p].offset, parts[p].offset + parts[p].count);
+
+    // In place, so a partition needs no memory beyond its slices. The keys stay
+    // for `split`, when ranks are being overwritten.
+    auto sort_by = [&](size_t lo, size_t hi, auto key) {
+      std::sort(suffixes.begin() + lo, suffixes.begin() + hi,
+                [&key](size_t a, size_t b) { return key(a) < key(b); });
+      for (size_t j = lo; j < hi; j++)
+        keys[j] = key(suffixes[j]);
+    };
+    // Ranks the suffixes of a sorted range, suffixes with equal keys get the same
+    // rank and form a new unsorted range
+    auto split = [&](size_t lo, size_t hi, ranges_t &out) {
+      for (size_t a = lo, b; a < hi; a = b) {
+        for (b = a + 1; b < hi and keys[b] == keys[a]; b++)
+          ;
+        for (size_t j = a; j < b; j++)
+          rank[suffixes[j]] = a;
+        if (b - a > 1)
+          out.emplace_back(a, b);
+      }
+    };
+    // Sorting and ranking are separate passes over all partitions - sorting reads
+    // ranks of other partitions, which must not change in the meantime
+    auto rank_all = [&] {
+      parallel::for_each_chunk(parts.size(), 1, workers, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++) {
+          ranges_t still;
+          for (const auto &range : unsorted[p])
+            split(range.first, range.second, still);
+          unsorted[p].swap(still);
+        }
+      });
+    };
+
+    parallel::for_each_chunk(parts.size(), 1, workers, [&](size_t begin, size_t end) {
+      for (size_t p = begin; p < end; p++)
+        sort_by(parts[p].offset, parts[p].offset + parts[p].count,
+                [&rank](size_t i) { return rank[i]; });
+    });
+    rank_all();
+    for (size_t h = code_length;; h *= 2) {
+      bool done = true;
+      for (const auto &ranges : unsorted)
+        done = done and ranges.empty();
+      if (done)
+        break;
+      auto key = [&rank, n, h](size_t i) -> std::uint64_t {
+        return i + h < n ? rank[i + h] + 1 : 0;
+      };
+      parallel::for_each_chunk(parts.size(), 1, workers, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+          for (const auto &range : unsorted[p])
+            sort_by(range.first, range.second, key);
+      });
+      rank_all();
+    }
+  }
+
+  // Kasai et al. - lcp[r] becomes the longest common prefix of suffixes[r - 1] and
+  // suffixes[r]. Every thread takes a chunk of the text, starting from scratch.
+  void longest_common_prefixes(const std::vector<std::uint64_t> &rank,
+                               std::vector<std::uint64_t> &lcp) {
+    const size_t n = the_string.size();
+    parallel::for_each_chunk(n, text_chunk(), workers, [&](size_t begin, size_t end) {
+      size_t h = 0;
+      for (size_t i = begin; i < end; i++) {
+        const size_t r = rank[i];
+        if (r == 0) {
+          h = 0;
+          continue;
+        }
+        const size_t j = suffixes[r - 1];
+        while (i + h < n and j + h < n and the_string[i + h] == the_string[j + h])
+          h++;
+        lcp[r] = h;
+        if (h > 0)
+          h--;
+      }
+    });
+  }
+
+  // The shared top - a node per symbol of every partition prefix but the last one,
+  // with a pending child for the partition's subtree.
+  void build_top(std::vector<partition> &parts) {
+    auto symbol = [this](const partition &p, size_t i) {
+      return alphabet[(p.code / power(p.length - 1 - i)) % base - 1];
+    };
+    for (auto &p : parts) {
+      const size_t end = p.offset + p.count;
+      std::vector<size_t> path = {0};
+      for (size_t d = 1; d < p.length; d++) {
+        T s = symbol(p, d - 1);
+        auto &children = nodes[path.back()].children;
+        // Partition prefixes are ordered, so a node shared with an earlier partition
+        // is always the last child
+        if (!children.empty() and children.back().first == s) {
+          assert(children.back().second != kPending and
+                 nodes[children.back().second].depth == d);
+          path.push_back(children.back().second);
+        } else {
+          children.emplace_back(s, nodes.size());
+          path.push_back(nodes.size());
+          nodes.emplace_back(d, p.offset);
+        }
+      }
+      for (size_t x : path)
+        nodes[x].hi = end;
+
+      // The suffix of a whole partition is the label of the last node on its path
+      if (!p.whole) {
+        auto &children = nodes[path.back()].children;
+        p.attach = path.back();
+        p.slot = children.size();
+        children.emplace_back(symbol(p, p.length - 1), kPending);
+      }
+    }
+  }
+
+  // Splits an oversized partition by its LCPs. Builds its trie with a stack, like
+  // build_subtree, but keeps only the nodes with more than max_suffixes suffixes
+  // below - they form its top. Runs of consecutive smaller children of a top node
+  // become partitions of at most max_suffixes suffixes.
+  split_top split_oversized(const partition &p, const std::vector<std::uint64_t> &lcp,
+                            size_t max_suffixes) const {
+    const size_t n = the_string.size(), end = p.offset + p.count;
+    // A closed subtree - a node of the top or a run of small sibling subtrees
+    struct piece {
+      bool top;
+      size_t lo, hi, count, index;
+    };
+    struct open {
+      size_t depth, lo;
+      std::vector<piece> pieces;
+    };
+    split_top result;
+    std::vector<open> stack;
+    stack.push_back(open{nodes[p.attach].depth, p.offset, {}});
+
+    auto add = [&](const piece &x) {
+      auto &pieces = stack.back().pieces;
+      if (!x.top and !pieces.empty() and !pieces.back().top and
+          x.hi - pieces.back().lo <= max_suffixes) {
+        pieces.back().hi = x.hi;
+        pieces.back().count++;
+      } else {
+        pieces.push_back(x);
+      }
+    };
+    // Closes the innermost open node, its suffixes end at hi
+    auto pop = [&](size_t hi) {
+      open x = std::move(stack.back());
+      stack.pop_back();
+      if (hi - x.lo <= max_suffixes)
+        return piece{false, x.lo, hi, 1, 0};
+      node top(x.depth, x.lo, hi);
+      for (const piece &c : x.pieces) {
+        const T symbol = the_string[suffixes[c.lo] + x.depth];
+        if (c.top) {
+          top.children.emplace_back(symbol, c.index);
+          continue;
+        }
+        partition q{0, 0, false, c.hi - c.lo};
+        q.offset = c.lo;
+        q.attach = result.nodes.size();
+        q.slot = top.children.size();
+        q.slots = c.count;
+        result.parts.push_back(std::move(q));
+        top.children.insert(top.children.end(), c.count, {symbol, kPending});
+      }
+      result.nodes.push_back(std::move(top));
+      return piece{true, x.lo, hi, 1, result.nodes.size() - 1};
+    };
+    auto close = [&](size_t depth, size_t hi) {
+      while (stack.back().depth > depth) {
+        piece x = pop(hi);
+        if (stack.back().depth < depth)
+          stack.push_back(open{depth, x.lo, {}});
+        add(x);
+      }
+    };
+
+    for (size_t r = p.offset; r < end; r++) {
+      if (r > p.offset)
+        close(lcp[r], r);
+      stack.push_back(open{n - suffixes[r], r, {}});
+    }
+    close(stack.front().depth, end);
+    // All suffixes share the prefix of the partition, so they are below one node
+    assert(stack.front().pieces.size() == 1 and stack.front().pieces.front().top);
+    result.root = stack.front().pieces.front().index;
+    return result;
+  }
+
+  // Number of nodes build_subtree creates for the partition
+  size_t subtree_size(const partition &p, const std::vector<std::uint64_t> &lcp) const {
+    const size_t n = the_string.size(), end = p.offset + p.count;
+    std::vector<size_t> depths = {nodes[p.attach].depth};
+    size_t size = 0;
+    for (size_t r = p.offset; r < end; r++) {
+      if (r > p.offset)
+        while (depths.back() > lcp[r]) {
+          depths.pop_back();
+          if (depths.back() < lcp[r]) {
+            depths.push_back(lcp[r]);
+            size++;
+          }
+        }
+      depths.push_back(n - suffixes[r]);
+      size++;
+    }
+    return size;
+  }
+
+  // Builds the compacted trie of a partition from its sorted suffixes and their LCPs
+  // into nodes[first, first + subtree_size(p)). The children of its root, which
+  // stands for node `attach` of the top, end up in p.roots.
+  void build_subtree(partition &p, size_t first,
+                     const std::vector<std::uint64_t> &lcp) {
+    const size_t n = the_string.size(), end = p.offset + p.count;
+    node root(nodes[p.attach].depth, p.offset);
+    auto at = [&](size_t x) -> node & { return x == kPending ? root : nodes[x]; };
+    std::vector<size_t> stack = {kPending};
+    size_t next = first;
+    auto create = [&](size_t depth, size_t lo) {
+      nodes[next] = node(depth, lo);
+      return next++;
+    };
+    auto attach = [&](size_t parent, size_t child) {
+      T symbol = the_string[suffixes[nodes[child].lo] + at(parent).depth];
+      at(parent).children.emplace_back(symbol, child);
+    };
+    // Pops everything deeper than `depth`, creating a node at `depth` if there is
+    // none on the path
+    auto close = [&](size_t depth, size_t hi) {
+      while (at(stack.back()).depth > depth) {
+        size_t last = stack.back();
+        stack.pop_back();
+        nodes[last].hi = hi;
+        if (at(stack.back()).depth < depth) {
+          const size_t x = create(depth, nodes[last].lo);
+          attach(x, last);
+          stack.push_back(x);
+        } else {
+          attach(stack.back(), last);
+        }
+      }
+    };
+    for (size_t r = p.offset; r < end; r++) {
+      if (r > p.offset)
+        close(lcp[r], r);
+      stack.push_back(create(n - suffixes[r], r));
+    }
+    close(root.depth, end);
+    assert(root.children.size() == p.slots);
+    p.roots = std::move(root.children);
+  }
+
+  // Builds the tries of all partitions. Oversized ones are split first and their tops
+  // added to the shared one, then every partition gets its range of the node array.
+  void build_subtrees(std::vector<partition> &parts,
+                      const std::vector<std::uint64_t> &lcp, size_t max_suffixes) {
+    std::vector<split_top> tops(parts.size());
+    parallel::for_each_chunk(parts.size(), 1, workers, [&](size_t begin, size_t end) {
+      for (size_t p = begin; p < end; p++)
+        if (parts[p].oversized)
+          tops[p] = split_oversized(parts[p], lcp, max_suffixes);
+    });
+    std::vector<partition> work;
+    for (size_t p = 0; p < parts.size(); p++) {
+      if (parts[p].whole)
+        continue;
+      if (!parts[p].oversized) {
+        work.push_back(std::move(parts[p]));
+        continue;
+      }
+      const size_t base_index = nodes.size();
+      for (auto &x : tops[p].nodes) {
+        for (auto &child : x.children)
+          if (child.second != kPending)
+            child.second += base_index;
+        nodes.push_back(std::move(x));
+      }
+      nodes[parts[p].attach].children[parts[p].slot].second =
+          base_index + tops[p].root;
+      for (auto &q : tops[p].parts) {
+        q.attach += base_index;
+        work.push_back(std::move(q));
+      }
+      tops[p] = split_top();
+    }
+    partitions = work.size();
+
+    std::vector<size_t> first(work.size());
+    parallel::for_each_chunk(work.size(), 1, workers, [&](size_t begin, size_t end) {
+      for (size_t p = begin; p < end; p++)
+        first[p] = subtree_size(work[p], lcp);
+    });
+    size_t total = nodes.size();
+    for (auto &x : first)
+      total += std::exchange(x, total);
+    nodes.resize(total, node(0, 0));
+
+    // Every partition writes only its own range of nodes and its own roots
+    parallel::for_each_chunk(work.size(), 1, workers, [&](size_t begin, size_t end) {
+      for (size_t p = begin; p < end; p++)
+        build_subtree(work[p], first[p], lcp);
+    });
+    for (const auto &p : work)
+      std::copy(p.roots.begin(), p.roots.end(),
+                nodes[p.attach].children.begin() + p.slot);
+  }
+
+  // The highest node whose label starts with the query
+  template <typename C2> std::optional<size_t> locate(const C2 &query) const {
+    const auto q = std::begin(query);
+    const size_t m = std::size(query);
+    size_t x = 0, matched = 0;
+    while (matched < m) {
+      const auto &children = nodes[x].children;
+      auto it = std::lower_bound(
+          children.begin(), children.end(), q[matched],
+          [](const std::pair<T, size_t> &child, const T &s) { return child.first < s; });
+      if (it == children.end() or !(it->first == q[matched]))
+        return {};
+      x = it->second;
+      const size_t label = suffixes[nodes[x].lo], until = std::min(nodes[x].depth, m);
+      for (; matched < until; matched++)
+        if (!(the_string[label + matched] == q[matched]))
+          return {};
+    }
+    return x;
+  }
+
+public:
+  PartitionedSuffixTree(const C &text, size_t threads = 0,
+                        size_t memory_budget = kDefaultMemoryBudget)
+      : the_string(std::begin(text), std::end(text)),
+        workers(threads == 0 ? parallel::default_threads() : threads) {
+    const size_t n = the_string.size();
+    nodes.emplace_back(0, 0, n);
+    if (n == 0)
+      return;
+
+    init_codes();
+    const size_t max_suffixes = std::max<size_t>(1, memory_budget / kBytesPerSuffix);
+    std::vector<partition> parts = plan(max_suffixes);
+
+    // Sorting keys, then LCPs
+    std::vector<std::uint64_t> keys(n);
+    suffixes.resize(n);
+    {
+      std::vector<std::uint64_t> rank(n);
+      distribute(parts, rank);
+      sort_suffixes(parts, keys, rank);
+      longest_common_prefixes(rank, keys);
+    }
+
+    build_top(parts);
+    build_subtrees(parts, keys, max_suffixes);
+  }
+
+  const T_vec &text() const { return the_string; }
+
+  size_t partition_count() const { return partitions; }
+
+  template <typename C2> bool find(const C2 &query) const {
+    return (bool)locate(query);
+  }
+
+  template <typename C2> size_t count(const C2 &query) const {
+    auto x = locate(query);
+    return x ? nodes[*x].hi - nodes[*x].lo : 0;
+  }
+
+  template <typename C2> std::vector<size_t> occurrences(const C2 &query) const {
+    auto x = locate(query);
+    if (!x)
+      return {};
+    return std::vector<size_t>(suffixes.begin() + nodes[*x].lo,
+                               suffixes.begin() + nodes[*x].hi);
+  }
+};
+
+} // namespace libalgo
+
+#endif // LIBALGO_PARTITIONED_SUFFIX_TREE
@@ -4,14 +4,32 @@
 // suffix trees
 //
 // Assuming input is a word over alphabet (a.....z)
+//
+// The tree is immutable once constructed. All queries are const and only read the
+// tree, so one tree can be shared and queried from any number of threads at once.
+// find_batch(queries, threads) answers a whole batch of patterns on all cores.
+//
+// Suffix links are kept after construction and used for matching a second text
+// against the tree in time linear in its length:
+// matching_statistics(query) - for every position i of the query the longest prefix
+//   of query[i:] that occurs in the text and where it occurs
+// longest_common_substring(query) - the longest substring of the query and the text
+// maximal_matches(query, min_length) - all matches of length >= min_length that
+//   can't be extended to the left or to the right
 
 #ifndef LIBALGO_SUFFIX_TREE
 #define LIBALGO_SUFFIX_TREE
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <fstream>
 #include <initializer_list>
+#include <iterator>
 #include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
 #include <string>
 #include <type_traits>
 // TODO move to robin_hood hashstructures
@@ -20,6 +38,8 @@
 #include <unordered_set>
 #include <vector>
 
+#include "libalgo/parallel.hh"
+#include "libalgo/suffix_tree_format.hh"
 #include "libalgo/type_check.hh"
 
 namespace libalgo {
@@ -29,16 +49,19 @@ template <typename C> class SuffixTree {
 public:
   using T = _type_check::inner_type_t<C>;
   using T_vec = std::vector<T>;
-  T_vec the_string;
 
 private:
+  T_vec the_string;
+
   struct node {
-    size_t left, right, full_left;
+    // After construction `full_left` of an internal node is the start of some
+    // occurrence of its label and `depth` is the length of the label
+    size_t left, right, full_left, depth = 0;
     // empty leaf is needed for implicit leaves
     node *fail = nullptr, *empty_leaf = nullptr;
     std::unordered_map<T, node *> children;
 
-    node *child(const T &symbol) {
+    node *child(const T &symbol) const {
       auto it = children.find(symbol);
       return it == children.end() ? nullptr : it->second;
     }
@@ -47,6 +70,7 @@ private:
     ~node() {
       for_each(children.begin(), children.end(),
                [](const auto &i) { delete i.second; });
+      delete empty_leaf;
     };
   };
 
@@ -98,6 +122,11 @@ private:
 
     // Convenience function
     auto active_offset = [&done, &active_end] { return done - active_end; };
+    // The edge going out of `active` towards `s[active_end]`. When `active` already
+    // spells the whole remaining suffix there is no such edge (and no `s[end]`).
+    auto active_edge = [&s, &active, &active_end, end] {
+      return active_end == end ? nullptr : active->child(s[active_end]);
+    };
 
     // We build the tree iteratively
     for (; done <= end; ++done) {
@@ -110,11 +139,11 @@ private:
       while (active_begin <= done) {
 
         // Find the new `active` node and active `edge`
-        edge = active->child(s[active_end]);
+        edge = active_edge();
         while (edge != nullptr and (edge->right) - (edge->left) <= active_offset()) {
           active = edge;
           active_end += (edge->right) - (edge->left);
-          edge = active->child(s[active_end]);
+          edge = active_edge();
         }
 
         // Check if `s[done]` is already in the tree in the right place below `active`.
@@ -171,9 +200,33 @@ private:
     return root;
   };
 
+  // Sets `depth` of every node and `full_left` of internal nodes
+  void annotate() {
+    std::vector<node *> order = {root};
+    for (size_t i = 0; i < order.size(); i++) {
+      node *x = order[i];
+      for (const auto &child : x->children) {
+        child.second->depth = x->depth + (child.second->right - child.second->left);
+        order.push_back(child.second);
+      }
+      if (x->empty_leaf != nullptr) {
+        x->empty_leaf->depth = x->depth;
+        order.push_back(x->empty_leaf);
+      }
+    }
+    // Children come after their parents in BFS order
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+      node *x = *it;
+      if (x->empty_leaf != nullptr)
+        x->full_left = x->empty_leaf->full_left;
+      else if (!x->children.empty())
+        x->full_left = x->children.begin()->second->full_left;
+    }
+  }
+
   template <typename C2>
-  std::optional<std::pair<node *, size_t>> find_node(const C2 &query) {
-    node *active = root;
+  std::optional<std::pair<const node *, size_t>> find_node(const C2 &query) const {
+    const node *active = root;
     size_t tree_ptr = active->right;
     for (auto it = std::begin(query); it != std::end(query); it++, tree_ptr++) {
       if (tree_ptr == active->right) {
@@ -188,18 +241,201 @@ private:
     return std::make_pair(active, tree_ptr - active->left);
   }
 
+  // find_batch() internals. A chunk of queries is matched `kBatchLanes` at a time,
+  // round robin, one edge per turn. Whenever a lane moves to a child it prefetches
+  // the child and the start of its label and lets the other lanes run, so the cache
+  // misses of neighbouring queries overlap instead of being paid one by one.
+  static constexpr size_t kBatchChunk = 256;
+  static constexpr size_t kBatchLanes = 8;
+
+  static inline void prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+  }
+
+  template <typename Q> struct lane {
+    const Q *query = nullptr;
+    size_t slot = 0, pos = 0, tree_ptr = 0;
+    const node *active = nullptr;
+  };
+
+  // One turn of a lane; returns false once the lane's query is answered
+  template <typename Q> bool step(lane<Q> &l, std::vector<char> &result) const {
+    auto q = std::begin(*l.query);
+    const size_t m = std::size(*l.query);
+    if (l.tree_ptr == l.active->right and l.pos < m) {
+      l.active = l.active->child(q[l.pos]);
+      if (l.active == nullptr)
+        return false;
+      l.tree_ptr = l.active->left;
+      prefetch(l.active);
+      prefetch(the_string.data() + l.tree_ptr);
+      return true;
+    }
+    for (; l.pos < m and l.tree_ptr < l.active->right; l.pos++, l.tree_ptr++)
+      if (the_string[l.tree_ptr] != q[l.pos])
+        return false;
+    if (l.pos == m) {
+      result[l.slot] = 1;
+      return false;
+    }
+    return true;
+  }
+
+  template <typename Qs>
+  void find_interleaved(const Qs &queries, size_t begin, size_t end,
+                        std::vector<char> &result) const {
+    using Q = std::decay_t<decltype(queries[0])>;
+    lane<Q> lanes[kBatchLanes];
+    size_t active_lanes = 0, next = begin;
+    auto start = [&](lane<Q> &l) {
+      l.query = &queries[next];
+      l.slot = next++;
+      l.pos = 0;
+      l.active = root;
+      l.tree_ptr = root->right;
+    };
+    for (; active_lanes < kBatchLanes and next < end; active_lanes++)
+      start(lanes[active_lanes]);
+    while (active_lanes > 0)
+      for (size_t i = 0; i < active_lanes;) {
+        if (step(lanes[i], result)) {
+          i++;
+        } else if (next < end) {
+          start(lanes[i]);
+        } else {
+          lanes[i] = lanes[--active_lanes];
+        }
+      }
+  }
+
 public:
   SuffixTree(const C &text)
-      : the_string(std::begin(text), std::end(text)), root(constructST(the_string)){};
+      : the_string(std::begin(text), std::end(text)), root(constructST(the_string)) {
+    annotate();
+  };
   ~SuffixTree() {
     (root->fail->children).clear();
     delete root->fail;
-    delete root;
+    // Detach all nodes first - deleting them recursively would overflow the stack on
+    // deep trees of repetitive texts
+    std::vector<node *> order = {root};
+    for (size_t i = 0; i < order.size(); i++) {
+      node *x = order[i];
+      for (const auto &child : x->children)
+        order.push_back(child.second);
+      if (x->empty_leaf != nullptr)
+        order.push_back(x->empty_leaf);
+      x->children.clear();
+      x->empty_leaf = nullptr;
+    }
+    for (node *x : order)
+      delete x;
+  };
+
+  const T_vec &text() const { return the_string; }
+
+  template <typename C2> bool find(const C2 &query) const {
+    return (bool)find_node(query);
+  }
+
+  // Answers find() for every query in a random access container of queries, spread
+  // over `threads` threads (0 = one per core). result[i] == 1 iff queries[i] was
+  // found.
+  template <typename Qs>
+  std::vector<char> find_batch(const Qs &queries, size_t threads = 0) const {
+    std::vector<char> result(std::size(queries), 0);
+    parallel::for_each_chunk(result.size(), kBatchChunk, threads,
+                             [&](size_t begin, size_t end) {
+                               find_interleaved(queries, begin, end, result);
+                             });
+    return result;
+  }
+
+  struct match {
+    size_t query_position, text_position, length;
   };
 
-  template <typename C2> bool find(const C2 &query) { return (bool)find_node(query); }
+  // Calls on_match(match) for i = 0, 1, ..., |query| - 1, where the match is the
+  // longest prefix of query[i:] occurring in the text. The query is read once from
+  // left to right (with random access to the part that is currently matched).
+  //
+  // Linear in |query|: the end of the match never moves back and moving its start
+  // forward is one suffix link plus skipping whole edges by their lengths.
+  template <typename C2, typename F>
+  void matching_statistics(const C2 &query, F on_match) const {
+    const auto q = std::begin(query);
+    const size_t m = std::size(query);
+    // The match is q[i, i + len). `v` is the deepest internal node on its path.
+    const node *v = root;
+    size_t len = 0;
+    for (size_t i = 0; i < m; i++) {
+      // The edge below `v` on which the match ends or nullptr if it ends in `v`
+      const node *e = nullptr;
+      while (true) {
+        size_t off = len - v->depth;
+        if (off > 0)
+          e = v->child(q[i + v->depth]);
+        else
+          e = i + len < m ? v->child(q[i + len]) : nullptr;
+        if (e == nullptr)
+          break;
+        const size_t edge_length = e->depth - v->depth;
+        while (off < edge_length and i + len < m and
+               the_string[e->left + off] == q[i + len])
+          off++, len++;
+        // Leaves end at the end of the text, there is nothing to follow below them
+        if (off < edge_length or e->children.empty())
+          break;
+        v = e;
+        e = nullptr;
+      }
+      on_match(match{i, (e != nullptr ? e : v)->full_left, len});
+
+      if (len == 0)
+        continue;
+      len--;
+      if (v != root)
+        v = v->fail;
+    }
+  }
+
+  template <typename C2> std::vector<match> matching_statistics(const C2 &query) const {
+    std::vector<match> result;
+    result.reserve(std::size(query));
+    matching_statistics(query, [&result](const match &x) { result.push_back(x); });
+    return result;
+  }
+
+  // The leftmost of the longest common substrings of the query and the text
+  template <typename C2> match longest_common_substring(const C2 &query) const {
+    match best = {0, 0, 0};
+    matching_statistics(query, [&best](const match &x) {
+      if (x.length > best.length)
+        best = x;
+    });
+    return best;
+  }
+
+  // Every match of length >= min_length (min_length > 0) that isn't a part of a
+  // longer match starting earlier in the query - so for each such substring of the
+  // query only one occurrence in the text is reported
+  template <typename C2>
+  std::vector<match> maximal_matches(const C2 &query, size_t min_length) const {
+    std::vector<match> result;
+    size_t previous = 0;
+    matching_statistics(query, [&](const match &x) {
+      if (x.length >= std::max<size_t>(min_length, 1) and previous <= x.length)
+        result.push_back(x);
+      previous = x.length;
+    });
+    return result;
+  }
 
-  bool has_all(node *x = nullptr) {
+  bool has_all(const node *x = nullptr) const {
     if (x == nullptr)
       x = root;
     if (x->fail == nullptr)
@@ -215,17 +451,94 @@ public:
     return true;
   }
 
-  std::vector<T_vec> all_suffixes() {
-    auto lowest =
-        find_node(the_string).value_or(std::pair<node *, size_t>(nullptr, 0)).first;
+  std::vector<T_vec> all_suffixes() const {
+    auto lowest = find_node(the_string)
+                      .value_or(std::pair<const node *, size_t>(nullptr, 0))
+                      .first;
     std::vector<T_vec> result;
-    while (lowest != nullptr and lowest->left != -1) {
+    while (lowest != nullptr and lowest->left != size_t(-1)) {
       result.emplace_back(the_string.begin() + lowest->full_left, the_string.end());
       lowest = lowest->fail;
     }
     return result;
   }
 
+  // Writes the tree in the format described in libalgo/suffix_tree_format.hh. The
+  // result can be opened with `MappedSuffixTree` without rebuilding the tree.
+  void save(std::ostream &out) const {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trees over trivially copyable symbols can be saved");
+    namespace fmt = suffix_tree_format;
+
+    // BFS numbering - children of a node (sorted by symbol) and then its empty leaf
+    // get consecutive indices.
+    std::vector<const node *> order = {root};
+    std::vector<std::uint64_t> first_child;
+    std::unordered_map<const node *, std::uint64_t> index = {{root, 0}};
+    std::vector<const node *> kids;
+    for (size_t i = 0; i < order.size(); i++) {
+      const node *x = order[i];
+      first_child.push_back(order.size());
+      kids.clear();
+      for (const auto &child : x->children)
+        kids.push_back(child.second);
+      std::sort(kids.begin(), kids.end(), [this](const node *a, const node *b) {
+        return fmt::symbol_less(the_string[a->left], the_string[b->left]);
+      });
+      if (x->empty_leaf != nullptr)
+        kids.push_back(x->empty_leaf);
+      for (const node *kid : kids) {
+        index[kid] = order.size();
+        order.push_back(kid);
+      }
+    }
+
+    fmt::header head = {};
+    head.magic = fmt::kMagic;
+    head.byte_order = fmt::kByteOrderMark;
+    head.version = fmt::kVersion;
+    head.symbol_size = sizeof(T);
+    head.node_size = sizeof(fmt::node_record);
+    head.text_length = the_string.size();
+    head.node_count = order.size();
+    head.file_size = fmt::file_size(head.text_length, sizeof(T), head.node_count);
+
+    const char padding[8] = {};
+    out.write(reinterpret_cast<const char *>(&head), sizeof(head));
+    out.write(padding, fmt::text_offset() - sizeof(head));
+    out.write(reinterpret_cast<const char *>(the_string.data()),
+              the_string.size() * sizeof(T));
+    out.write(padding, fmt::padded(the_string.size() * sizeof(T)) -
+                           the_string.size() * sizeof(T));
+
+    auto index_of = [&index](const node *x) {
+      auto it = index.find(x);
+      return it == index.end() ? fmt::kNoNode : it->second;
+    };
+    for (size_t i = 0; i < order.size(); i++) {
+      const node *x = order[i];
+      fmt::node_record record = {};
+      record.left = x->left;
+      record.right = x->right;
+      record.full_left = x->full_left;
+      // `root->fail` is the auxiliary state and is not a part of the tree
+      record.fail = x == root ? fmt::kNoNode : index_of(x->fail);
+      record.first_child = first_child[i];
+      record.empty_leaf = index_of(x->empty_leaf);
+      record.child_count = x->children.size();
+      out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+    if (!out)
+      throw std::runtime_error("SuffixTree::save: write failed");
+  }
+
+  void save(const std::string &path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+      throw std::runtime_error("SuffixTree::save: cannot open " + path);
+    save(out);
+  }
+
   template <typename...> friend class GeneralisedSuffixTree;
 };
 } // namespace libalgo
@@ -0,0 +1,88 @@
+// Stanislaw Morawski
+//
+// On-disk format of a built SuffixTree.
+//
+// The file is a flat, position independent image of the tree - there are no
+// pointers in it, only indices - so it can be `mmap`ed and queried in place (see
+// libalgo/mapped_suffix_tree.hh). Layout (all fields in native byte order, every
+// section starts at a multiple of 8 bytes):
+//
+//   header       - `suffix_tree_format::header`
+//   text         - `text_length` symbols, padded with zeros up to 8 bytes
+//   nodes        - `node_count` records of `suffix_tree_format::node_record`
+//
+// Nodes are numbered in BFS order with all children of a node stored next to each
+// other and sorted by the first symbol of their edge, so a node only has to remember
+// where its children start and how many of them there are. Integral symbols are
+// compared as unsigned (`symbol_less`), so the order of `char`s doesn't depend on
+// whether the platform's char is signed. The implicit empty leaf (if any) is stored
+// right after the children and is not included in `child_count`. Suffix links are
+// kept as node indices.
+
+#ifndef LIBALGO_SUFFIX_TREE_FORMAT
+#define LIBALGO_SUFFIX_TREE_FORMAT
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace libalgo {
+namespace suffix_tree_format {
+
+// "LASUFTRE" read as a little endian number
+constexpr std::uint64_t kMagic = 0x455254465553414cull;
+// Written as is; reading it back in a different byte order gives a different value
+constexpr std::uint32_t kByteOrderMark = 0x01020304u;
+// Version 2 - children of integral symbols sorted as unsigned
+constexpr std::uint32_t kVersion = 2;
+// Marks a missing node (no suffix link, no empty leaf)
+constexpr std::uint64_t kNoNode = ~std::uint64_t(0);
+
+struct header {
+  std::uint64_t magic;
+  std::uint32_t byte_order;
+  std::uint32_t version;
+  std::uint32_t symbol_size;
+  std::uint32_t node_size;
+  std::uint64_t text_length;
+  std::uint64_t node_count;
+  // Total size of the file, used to detect truncated files
+  std::uint64_t file_size;
+};
+
+struct node_record {
+  // Edge label is text[left, right), `full_left` is where the suffix of a leaf starts
+  std::uint64_t left, right, full_left;
+  std::uint64_t fail;
+  std::uint64_t first_child;
+  std::uint64_t empty_leaf;
+  std::uint64_t child_count;
+};
+
+// The order of children in the file
+template <typename T> bool symbol_less(const T &a, const T &b) {
+  if constexpr (std::is_integral<T>::value and !std::is_same<T, bool>::value)
+    return std::make_unsigned_t<T>(a) < std::make_unsigned_t<T>(b);
+  else
+    return a < b;
+}
+
+inline constexpr std::uint64_t padded(std::uint64_t bytes) { return (bytes + 7) & ~7ull; }
+
+inline constexpr std::uint64_t text_offset() { return padded(sizeof(header)); }
+
+inline constexpr std::uint64_t nodes_offset(std::uint64_t text_length,
+                                            std::uint64_t symbol_size) {
+  return text_offset() + padded(text_length * symbol_size);
+}
+
+inline constexpr std::uint64_t file_size(std::uint64_t text_length,
+                                         std::uint64_t symbol_size,
+                                         std::uint64_t node_count) {
+  return nodes_offset(text_length, symbol_size) + node_count * sizeof(node_record);
+}
+
+} // namespace suffix_tree_format
+} // namespace libalgo
+
+#endif // LIBALGO_SUFFIX_TREE_FORMAT
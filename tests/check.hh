@@ -0,0 +1,38 @@
+// Minimal checking for the randomized tests - no dependencies on a test framework.
+//
+// CHECK(condition) reports a failed condition (with the seed of the current case)
+// and lets the test go on, so one run shows all the differences it found.
+// check::result() is the exit code of the test.
+
+#ifndef LIBALGO_TESTS_CHECK
+#define LIBALGO_TESTS_CHECK
+
+#include <cstdint>
+#include <iostream>
+
+namespace check {
+
+inline int failures = 0;
+inline std::uint64_t seed = 0;
+
+inline void fail(const char *condition, const char *file, int line) {
+  if (failures++ < 20)
+    std::cerr << file << ":" << line << ": CHECK(" << condition
+              << ") failed, seed = " << seed << std::endl;
+}
+
+inline int result() {
+  if (failures > 0)
+    std::cerr << failures << " check(s) failed" << std::endl;
+  return failures > 0 ? 1 : 0;
+}
+
+} // namespace check
+
+#define CHECK(condition)                                                               \
+  do {                                                                                 \
+    if (!(condition))                                                                  \
+      check::fail(#condition, __FILE__, __LINE__);                                     \
+  } while (false)
+
+#endif // LIBALGO_TESTS_CHECK
@@ -0,0 +1,101 @@
+// Randomized differential test of IntervalTree against a naive reference.
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "check.hh"
+#include "libalgo/interval_tree.hh"
+
+namespace {
+
+// Every position of a small range stored explicitly
+void small_range(std::mt19937_64 &rng) {
+  const int64_t size = 1 + rng() % 300;
+  using Tree = libalgo::IntervalTree<int64_t, int64_t>;
+  Tree first(size);
+  std::optional<Tree> second;
+  Tree *tree = &first;
+  std::vector<int64_t> naive(size, 0);
+  auto range = [&] {
+    int64_t b = rng() % size, e = rng() % size;
+    if (b > e)
+      std::swap(b, e);
+    return std::make_pair(b, e + 1);
+  };
+  for (int op = 0; op < 2000; op++) {
+    // Moving hands the nodes over, later updates still have to reach the new root
+    if (op == 1000) {
+      second.emplace(std::move(first));
+      CHECK(first.query(0, size) == 0);
+      tree = &*second;
+    } else if (op == 1500) {
+      first = std::move(*second);
+      tree = &first;
+    }
+    auto [b, e] = range();
+    if (rng() % 2) {
+      int64_t value = int64_t(rng() % 201) - 100;
+      tree->add(value, b, e);
+      for (int64_t i = b; i < e; i++)
+        naive[i] += value;
+    } else {
+      CHECK(tree->query(b, e) ==
+            *std::max_element(naive.begin() + b, naive.begin() + e));
+      // Answered by the root, which every update has to reach
+      CHECK(tree->query(0, size) == *std::max_element(naive.begin(), naive.end()));
+    }
+  }
+}
+
+// A huge range - the reference keeps the list of additions and evaluates the
+// maximum only at the points where it can change
+void huge_range(std::mt19937_64 &rng) {
+  const int64_t size = int64_t(1) << 60;
+  libalgo::IntervalTree<int64_t, int64_t> tree(0, size);
+  struct addition {
+    int64_t value, begin, end;
+  };
+  std::vector<addition> added;
+  auto value_at = [&added](int64_t x) {
+    int64_t result = 0;
+    for (const auto &a : added)
+      if (a.begin <= x and x < a.end)
+        result += a.value;
+    return result;
+  };
+  auto range = [&] {
+    int64_t b = rng() % size, e = rng() % size;
+    if (b > e)
+      std::swap(b, e);
+    return std::make_pair(b, e + 1);
+  };
+  for (int op = 0; op < 300; op++) {
+    auto [b, e] = range();
+    if (rng() % 2) {
+      added.push_back({int64_t(rng() % 201) - 100, b, e});
+      tree.add(added.back().value, b, e);
+    } else {
+      int64_t expected = value_at(b);
+      for (const auto &a : added)
+        for (int64_t x : {a.begin, a.end})
+          if (b < x and x < e)
+            expected = std::max(expected, value_at(x));
+      CHECK(tree.query(b, e) == expected);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  for (check::seed = 1; check::seed <= 50; check::seed++) {
+    std::mt19937_64 rng(check::seed);
+    small_range(rng);
+    huge_range(rng);
+  }
+  return check::result();
+}
@@ -0,0 +1,56 @@
+// Randomized differential test of SplaySet against std::set.
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "check.hh"
+#include "libalgo/set.hh"
+
+namespace {
+
+void random_operations(std::mt19937_64 &rng) {
+  const int64_t range = 1 + rng() % 1000;
+  libalgo::SplaySet<int64_t> set;
+  std::set<int64_t> naive;
+  for (int op = 0; op < 3000; op++) {
+    int64_t x = int64_t(rng() % range) - range / 2;
+    switch (rng() % 5) {
+    case 0:
+    case 1:
+      set.insert(x);
+      naive.insert(x);
+      break;
+    case 2:
+      set.erase(x);
+      naive.erase(x);
+      break;
+    case 3:
+      CHECK(set.find(x) == (naive.count(x) == 1));
+      break;
+    case 4: {
+      int64_t value = rng() % 10;
+      set.shift(x, value);
+      std::set<int64_t> shifted;
+      for (int64_t y : naive)
+        shifted.insert(y >= x ? y + value : y);
+      naive.swap(shifted);
+      break;
+    }
+    }
+    if (op % 16 == 0)
+      CHECK(set.sortedValues() == std::vector<int64_t>(naive.begin(), naive.end()));
+  }
+  CHECK(set.sortedValues() == std::vector<int64_t>(naive.begin(), naive.end()));
+}
+
+} // namespace
+
+int main() {
+  for (check::seed = 1; check::seed <= 50; check::seed++) {
+    std::mt19937_64 rng(check::seed);
+    random_operations(rng);
+  }
+  return check::result();
+}
@@ -0,0 +1,228 @@
+// Randomized differential test of SuffixTree, MappedSuffixTree and
+// PartitionedSuffixTree against naive substring search.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "check.hh"
+#include "libalgo/mapped_suffix_tree.hh"
+#include "libalgo/partitioned_suffix_tree.hh"
+#include "libalgo/suffix_tree.hh"
+
+namespace {
+
+std::string random_text(std::mt19937_64 &rng, size_t length, size_t alphabet) {
+  std::string result;
+  for (size_t i = 0; i < length; i++)
+    result += char('a' + rng() % alphabet);
+  return result;
+}
+
+// Substrings of the text mixed with random words
+std::vector<std::string> random_queries(std::mt19937_64 &rng, const std::string &text,
+                                        size_t alphabet, size_t count) {
+  std::vector<std::string> result;
+  for (size_t i = 0; i < count; i++) {
+    size_t length = rng() % 10;
+    if (rng() % 2 and length <= text.size())
+      result.push_back(text.substr(rng() % (text.size() - length + 1), length));
+    else
+      result.push_back(random_text(rng, length, alphabet));
+  }
+  return result;
+}
+
+std::vector<size_t> naive_occurrences(const std::string &text, const std::string &query) {
+  std::vector<size_t> result;
+  for (size_t i = 0; i < text.size() and i + query.size() <= text.size(); i++)
+    if (text.compare(i, query.size(), query) == 0)
+      result.push_back(i);
+  return result;
+}
+
+size_t naive_longest_match(const std::string &text, const std::string &query,
+                           size_t from) {
+  size_t length = 0;
+  while (from + length < query.size() and
+         text.find(query.substr(from, length + 1)) != std::string::npos)
+    length++;
+  return length;
+}
+
+bool occurs(const std::string &text, const std::string &query, size_t from,
+            size_t length) {
+  return text.find(query.substr(from, length)) != std::string::npos;
+}
+
+// Pairs (query position, length) of substrings of the query that occur in the text
+// but don't when extended by a symbol to the left or to the right
+std::vector<std::pair<size_t, size_t>>
+naive_maximal_matches(const std::string &text, const std::string &query,
+                      size_t min_length) {
+  std::vector<std::pair<size_t, size_t>> result;
+  for (size_t i = 0; i < query.size(); i++)
+    for (size_t length = std::max<size_t>(min_length, 1); i + length <= query.size();
+         length++) {
+      if (!occurs(text, query, i, length))
+        break;
+      const bool right =
+          i + length == query.size() or !occurs(text, query, i, length + 1);
+      const bool left = i == 0 or !occurs(text, query, i - 1, length + 1);
+      if (left and right)
+        result.emplace_back(i, length);
+    }
+  return result;
+}
+
+void queries(std::mt19937_64 &rng, const std::string &text, size_t alphabet) {
+  const libalgo::SuffixTree tree(text);
+  CHECK(tree.has_all());
+  // Every suffix including the empty one (which is the root itself for empty text)
+  CHECK(tree.all_suffixes().size() == (text.empty() ? 0 : text.size() + 1));
+
+  auto batch = random_queries(rng, text, alphabet, 300);
+  auto found = tree.find_batch(batch, 1 + rng() % 4);
+  for (size_t i = 0; i < batch.size(); i++) {
+    bool expected = text.find(batch[i]) != std::string::npos;
+    CHECK(tree.find(batch[i]) == expected);
+    CHECK(bool(found[i]) == expected);
+  }
+}
+
+void matching(std::mt19937_64 &rng, const std::string &text, size_t alphabet) {
+  const libalgo::SuffixTree tree(text);
+  const std::string query = random_text(rng, rng() % 100, alphabet);
+
+  auto statistics = tree.matching_statistics(query);
+  CHECK(statistics.size() == query.size());
+  size_t longest = 0;
+  for (size_t i = 0; i < statistics.size(); i++) {
+    const auto &x = statistics[i];
+    CHECK(x.query_position == i);
+    CHECK(x.length == naive_longest_match(text, query, i));
+    CHECK(text.compare(x.text_position, x.length, query, i, x.length) == 0);
+    longest = std::max(longest, x.length);
+  }
+  CHECK(tree.longest_common_substring(query).length == longest);
+
+  const size_t min_length = 1 + rng() % 4;
+  auto maximal = tree.maximal_matches(query, min_length);
+  auto expected = naive_maximal_matches(text, query, min_length);
+  CHECK(maximal.size() == expected.size());
+  for (size_t i = 0; i < std::min(maximal.size(), expected.size()); i++) {
+    const auto &x = maximal[i];
+    CHECK(x.query_position == expected[i].first and x.length == expected[i].second);
+    CHECK(x.text_position + x.length <= text.size() and
+          text.compare(x.text_position, x.length, query, x.query_position, x.length) ==
+              0);
+  }
+}
+
+void mapped(std::mt19937_64 &rng, const std::string &text, size_t alphabet) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("libalgo_test_" + std::to_string(getpid()) + ".sufftree"))
+          .string();
+  // Half of the letters become bytes above 127, negative as a signed char
+  auto high = [](std::string s) {
+    for (auto &c : s)
+      if ((c - 'a') % 2)
+        c = char(c + 128);
+    return s;
+  };
+  libalgo::SuffixTree(high(text)).save(path);
+  {
+    libalgo::MappedSuffixTree<char> tree(path);
+    CHECK(tree.validate());
+    CHECK(tree.size() == text.size());
+    // The same file read with the other signedness of char
+    libalgo::MappedSuffixTree<unsigned char> unsigned_tree(path);
+    CHECK(unsigned_tree.validate());
+    for (const auto &query : random_queries(rng, text, alphabet, 100)) {
+      const bool expected = text.find(query) != std::string::npos;
+      const std::string stored = high(query);
+      CHECK(tree.find(stored) == expected);
+      const std::vector<unsigned char> bytes(stored.begin(), stored.end());
+      CHECK(unsigned_tree.find(bytes) == expected);
+    }
+
+    bool thrown = false;
+    try {
+      libalgo::MappedSuffixTree<int> wrong_symbol(path);
+    } catch (const std::runtime_error &) {
+      thrown = true;
+    }
+    CHECK(thrown);
+  }
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  bool thrown = false;
+  try {
+    libalgo::MappedSuffixTree<char> truncated(path);
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  std::remove(path.c_str());
+}
+
+void partitioned(std::mt19937_64 &rng, const std::string &text, size_t alphabet) {
+  using Tree = libalgo::PartitionedSuffixTree<std::string>;
+  const size_t threads = 1 + rng() % 4;
+  // Small budgets force long partition prefixes. Repeating the text makes many
+  // suffixes share more symbols than a prefix code holds, so these get split by
+  // their LCPs.
+  for (const std::string &indexed : {text, text + text + text}) {
+    const Tree tree(indexed, threads, (1 + rng() % 40) * Tree::kBytesPerSuffix);
+    for (const auto &query : random_queries(rng, indexed, alphabet, 200)) {
+      auto expected = naive_occurrences(indexed, query);
+      auto got = tree.occurrences(query);
+      std::sort(got.begin(), got.end());
+      CHECK(got == expected);
+      CHECK(tree.count(query) == expected.size());
+      CHECK(tree.find(query) == (!expected.empty() or query.empty()));
+    }
+    // The empty query is a substring of every text but occurs only at its positions
+    CHECK(tree.find(std::string()));
+    CHECK(tree.count(std::string()) == indexed.size());
+  }
+
+  // Every suffix of a unary text shares the longest prefix there is
+  const std::string unary(1000, 'a');
+  const Tree tree(unary, threads, 10 * Tree::kBytesPerSuffix);
+  for (size_t length = 1; length <= unary.size(); length += 1 + rng() % 50)
+    CHECK(tree.count(unary.substr(0, length)) == unary.size() - length + 1);
+}
+
+} // namespace
+
+int main() {
+  for (check::seed = 1; check::seed <= 200; check::seed++) {
+    std::mt19937_64 rng(check::seed);
+    const size_t alphabet = 1 + rng() % 4;
+    const std::string text = random_text(rng, rng() % 300, alphabet);
+    queries(rng, text, alphabet);
+    matching(rng, text, alphabet);
+    mapped(rng, text, alphabet);
+    partitioned(rng, text, alphabet);
+  }
+
+  // The empty text still has the empty substring, with no position to start at
+  check::seed = 0;
+  const libalgo::SuffixTree empty(std::string{});
+  CHECK(empty.find(std::string()));
+  const libalgo::PartitionedSuffixTree<std::string> partitioned_empty(std::string{});
+  CHECK(partitioned_empty.find(std::string()));
+  CHECK(partitioned_empty.count(std::string()) == 0);
+  CHECK(partitioned_empty.occurrences(std::string()).empty());
+  return check::result();
+}